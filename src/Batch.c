@@ -0,0 +1,252 @@
+#include "JsonLogger.h"
+
+#define batchKey(item) ((item)[0] == 'f' ? &(item)[3] : &(item)[2])
+
+// worst case length of one value plus its comma, e.g. -2147483648, or -1.2345e-308,
+static int value_width(const char* item) {
+  if (item[0] == 'i') {
+    return 12;
+  }
+  if (item[0] == 'b') {
+    return 6;
+  }
+  uint8_t digits = item[1] >= 'a' ? item[1] - 'a' + 10 : item[1] - '0';
+  if (digits > 17) {
+    digits = 17;
+  }
+  return digits + 8;
+}
+
+// Reads a record into row batch->rows. If define is set, the record's keys become the columns.
+// Otherwise returns 0 when the record doesn't have the same keys as the columns.
+static int read_row(JsonBatch* batch, const char* item, va_list args, int8_t define) {
+  int col = 0;
+  for (; item; item = va_arg(args, const char*), col++) {
+    if (col >= LOG_BATCH_MAX_COLS) {
+      return define ? JSON_ERR_BUF_SIZE : 0;
+    }
+    if (define) {
+      batch->items[col] = item;
+    } else if (col >= batch->cols || strcmp(batch->items[col], item)) {
+      return 0;
+    }
+
+    if (item[1] == '|' && (item[0] == 'i' || item[0] == 'b')) {
+      batch->values[col].i[batch->rows] = va_arg(args, int32_t);
+    } else if (item[2] == '|' && item[0] == 'f') {
+      batch->values[col].f[batch->rows] = va_arg(args, double);
+    } else {
+      return JSON_ERR_BATCH_TYPE;
+    }
+  }
+
+  if (define) {
+    batch->cols = col;
+    batch->bytes = 0;
+    batch->row_bytes = 0;
+    for (col = 0; col < batch->cols; col++) {
+      batch->bytes += strlen(batchKey(batch->items[col])) + 6;  // ,"key":[]
+      batch->row_bytes += value_width(batch->items[col]);
+    }
+    if (batch->bytes + batch->row_bytes > batch->max_bytes) {
+      return JSON_ERR_BUF_SIZE;
+    }
+  } else if (col != batch->cols) {
+    return 0;
+  }
+  return 1;
+}
+
+static int8_t time_is_up(JsonBatch* batch) {
+  return batch->rows > 0 && batch->now_ms && batch->max_ms && batch->now_ms() - batch->first_ms >= batch->max_ms;
+}
+
+void logBatchInit(JsonBatch* batch, int level, int max_rows, int max_bytes, uint32_t max_ms, uint32_t (*now_ms)()) {
+  memset(batch, 0, sizeof(JsonBatch));
+  batch->level = level;
+  batch->max_rows = max_rows > 0 && max_rows < LOG_BATCH_MAX_ROWS ? max_rows : LOG_BATCH_MAX_ROWS;
+  batch->max_bytes = max_bytes > 0 && max_bytes < LOG_BATCH_MAX_BYTES ? max_bytes : LOG_BATCH_MAX_BYTES;
+  batch->max_ms = max_ms;
+  batch->now_ms = now_ms;
+}
+
+int logBatchFlush(JsonBatch* batch) {
+  if (batch->rows == 0) {
+    return 0;
+  }
+  char json[LOG_MAX_LEN] = "+|";
+  int len = 2;
+  for (int col = 0; col < batch->cols; col++) {
+    const char* item = batch->items[col];
+    char array[4] = {item[0], '[', '\0', '\0'};  // "i[", "b[" or "f#[": array without key
+    if (item[0] == 'f') {
+      array[1] = item[1];
+      array[2] = '[';
+    }
+
+    int n = snprintf(&json[len], sizeof(json) - len, col ? ",\"%s\":" : "\"%s\":", batchKey(item));
+    if (n < 0 || n >= (int)sizeof(json) - len) {
+      batch->rows = 0;
+      return JSON_ERR_BUF_SIZE;
+    }
+    len += n;
+
+    if (item[0] == 'f') {
+      n = build_json(&json[len], sizeof(json) - len, array, (int32_t)batch->rows, batch->values[col].f, NULL);
+    } else {
+      n = build_json(&json[len], sizeof(json) - len, array, (int32_t)batch->rows, batch->values[col].i, NULL);
+    }
+    if (n < 0) {
+      batch->rows = 0;
+      return n;
+    }
+    len += n;
+  }
+  batch->rows = 0;
+
+  log_json(batch->level, "", json, NULL);
+  return len - 2;
+}
+
+int logBatchPoll(JsonBatch* batch) {
+  return time_is_up(batch) ? logBatchFlush(batch) : 0;
+}
+
+int log_batch(JsonBatch* batch, const char* item, ...) {
+  va_list args;
+  int ret = 0;
+  if (batch->level < LOG_MIN_LEVEL) {  // compiled out like logJson()
+    return 0;
+  }
+  if (batch->rows > 0 && batch->bytes + batch->row_bytes > batch->max_bytes) {
+    logBatchFlush(batch);
+  }
+  if (batch->rows > 0) {
+    va_start(args, item);
+    ret = read_row(batch, item, args, 0);
+    va_end(args);
+    if (ret == 0) {  // keys changed: send what we have and start over with the new keys
+      logBatchFlush(batch);
+    }
+  }
+  if (batch->rows == 0) {
+    va_start(args, item);
+    ret = read_row(batch, item, args, 1);
+    va_end(args);
+    if (batch->now_ms) {
+      batch->first_ms = batch->now_ms();
+    }
+  }
+  if (ret < 0) {
+    batch->rows = 0;
+    return ret;
+  }
+
+  batch->rows++;
+  batch->bytes += batch->row_bytes;
+  if (batch->rows >= batch->max_rows || batch->bytes + batch->row_bytes > batch->max_bytes || time_is_up(batch)) {
+    return logBatchFlush(batch);
+  }
+  return 0;
+}
+
+#ifdef BATCH_TEST
+// gcc -Os -DBATCH_TEST src/*.c; ./a.out; rm ./a.out
+
+#include <assert.h>
+
+static char sent[LOG_MAX_LEN];
+static int sent_count = 0;
+static uint32_t now = 0;
+
+void send_capture(int level, const char* json, int len) {
+  printf("%s\n", json);
+  memcpy(sent, json, len + 1);
+  sent_count++;
+}
+
+uint32_t fake_ms() {
+  return now;
+}
+
+int main() {
+  logAddSender(send_capture);
+  JsonBatch batch;
+
+  // count
+  logBatchInit(&batch, LEVEL_INFO, 3, 0, 0, NULL);
+  for (int i = 0; i < 3; i++) {
+    logBatch(&batch, "i|n", i, "f5|x", i * 1.5, "b|ok", i != 1);
+  }
+  assert(sent_count == 1);
+  assert(!strcmp(sent, "{\"l\":2,\"n\":[0,1,2],\"x\":[0,1.5,3],\"ok\":[true,false,true]}"));
+
+  // flush on demand, nothing to flush afterwards
+  logBatch(&batch, "i|n", 7, "f5|x", 0.25, "b|ok", 0);
+  assert(sent_count == 1);
+  assert(logBatchFlush(&batch) > 0);
+  assert(sent_count == 2);
+  assert(!strcmp(sent, "{\"l\":2,\"n\":[7],\"x\":[0.25],\"ok\":[false]}"));
+  assert(logBatchFlush(&batch) == 0);
+  assert(sent_count == 2);
+
+  // keys changed
+  logBatch(&batch, "i|n", 1);
+  logBatch(&batch, "i|m", 2);
+  assert(sent_count == 3);
+  assert(!strcmp(sent, "{\"l\":2,\"n\":[1]}"));
+  logBatchFlush(&batch);
+  assert(!strcmp(sent, "{\"l\":2,\"m\":[2]}"));
+
+  // bytes: ,"v":[] is 7, then 12 per row; sent as soon as the next row wouldn't fit
+  logBatchInit(&batch, LEVEL_INFO, 0, 7 + 12 * 2, 0, NULL);
+  sent_count = 0;
+  logBatch(&batch, "i|v", -2147483647 - 1);
+  assert(sent_count == 0);
+  logBatch(&batch, "i|v", -2147483647 - 1);
+  assert(sent_count == 1);
+  for (int i = 0; i < 3; i++) {
+    logBatch(&batch, "i|v", -2147483647 - 1);
+  }
+  assert(sent_count == 2);
+  assert(!strcmp(sent, "{\"l\":2,\"v\":[-2147483648,-2147483648]}"));
+  logBatchFlush(&batch);
+  assert(sent_count == 3);
+  assert(!strcmp(sent, "{\"l\":2,\"v\":[-2147483648]}"));
+
+  // time
+  logBatchInit(&batch, LEVEL_DEBUG, 0, 0, 100, fake_ms);
+  sent_count = 0;
+  logBatch(&batch, "i|v", 1);
+  now = 50;
+  logBatch(&batch, "i|v", 2);
+  assert(logBatchPoll(&batch) == 0);
+  assert(sent_count == 0);
+  now = 100;
+  assert(logBatchPoll(&batch) > 0);
+  assert(sent_count == 1);
+  assert(!strcmp(sent, "{\"l\":1,\"v\":[1,2]}"));
+  logBatch(&batch, "i|v", 3);
+  now = 250;
+  logBatch(&batch, "i|v", 4);
+  assert(sent_count == 2);
+  assert(!strcmp(sent, "{\"l\":1,\"v\":[3,4]}"));
+
+  // error conditions
+  assert(logBatch(&batch, "i|v", 1, "str", "not a number") == JSON_ERR_BATCH_TYPE);
+  assert(logBatchFlush(&batch) == 0);
+  logBatchInit(&batch, LEVEL_INFO, 0, 10, 0, NULL);
+  assert(logBatch(&batch, "i|value", 1) == JSON_ERR_BUF_SIZE);
+  assert(sent_count == 2);
+
+  // below LOG_MIN_LEVEL
+  logBatchInit(&batch, LEVEL_TRACE, 2, 0, 0, NULL);
+  sent_count = 0;
+  logBatch(&batch, "i|x", 1);
+  logBatch(&batch, "i|x", 2);
+  assert(logBatchFlush(&batch) == 0);
+  assert(sent_count == 0);
+
+  return 0;
+}
+#endif
@@ -31,6 +31,18 @@ extern const char* getLogTime();
 // define LOG_SOURCE_KEY (e.g. -D LOG_SOURCE_KEY="s") if you want to log source file, line # and function name
 //#define LOG_SOURCE_KEY "s"
 
+// define LOG_PROFILE and implement getLogProfileTicks() (e.g. micros() or a cycle counter) if you want to
+// measure calls, ticks and bytes of every logJson() call site; get the most expensive ones with logProfileReport()
+//#define LOG_PROFILE
+
+// define LOG_SHM (POSIX only, may need -lrt) if you want processes to hand their logs to one collector process
+// through a shared memory ring: logShmOpen() and logAddSender(logShmSend) in producers, logShmDrain() in the collector
+//#define LOG_SHM
+
+// define LOG_SPAN and implement getLogMicros() (a monotonic clock in microseconds, e.g. micros()) if you want to
+// time operations with logSpanBegin()/logSpanEnd() and send them as Chrome trace events (chrome://tracing, Perfetto)
+//#define LOG_SPAN
+
 void logAddSender(void (*sender)(int level, const char* json, int len));
 void logModifyForHuman(int level, char* json);
 
@@ -40,6 +52,8 @@ void logModifyForHuman(int level, char* json);
 
 #define JSON_ERR_BUF_SIZE -1
 #define JSON_ERR_BRACES_MISMATCH -2
+#define JSON_ERR_BATCH_TYPE -3
+#define JSON_ERR_SHM -4
 
 #ifndef LOG_MIN_LEVEL
 #define LOG_MIN_LEVEL 1
@@ -49,6 +63,17 @@ void logModifyForHuman(int level, char* json);
 #define LOG_MAX_LEN 512
 #endif
 
+#ifndef LOG_BATCH_MAX_COLS
+#define LOG_BATCH_MAX_COLS 8
+#endif
+
+#ifndef LOG_BATCH_MAX_ROWS
+#define LOG_BATCH_MAX_ROWS 16
+#endif
+
+#define LOG_RECORD_MAX_BYTES (LOG_MAX_LEN - 64)  // fragment passed to log_json(): leaves room for the time, id and level
+#define LOG_BATCH_MAX_BYTES LOG_RECORD_MAX_BYTES
+
 #ifndef EMPTY_KEY
 #define EMPTY_KEY "_"
 #endif
@@ -68,7 +93,83 @@ void logModifyForHuman(int level, char* json);
 #define LEVEL_DEBUG 1
 #define LEVEL_TRACE 0
 
-#ifdef LOG_SOURCE_KEY
+#ifndef LOG_SAFE_SLOTS
+#define LOG_SAFE_SLOTS 4  // power of 2, at least 2
+#endif
+#if LOG_SAFE_SLOTS < 2 || (LOG_SAFE_SLOTS & (LOG_SAFE_SLOTS - 1))
+#error "LOG_SAFE_SLOTS must be a power of 2, at least 2"
+#endif
+
+#ifndef LOG_SAFE_LEN
+#define LOG_SAFE_LEN 128
+#endif
+
+#ifndef LOG_SAFE_RETRIES
+#define LOG_SAFE_RETRIES 8  // claim attempts lost to other writers before the record is dropped
+#endif
+
+// log_json_safe() worst case: LOG_SAFE_RETRIES + 2 compare-and-swaps, reading and writing at most LOG_SAFE_LEN bytes
+// (under 1 us on a desktop x86-64) and at most LOG_SAFE_STACK bytes of stack in optimized builds
+#define LOG_SAFE_STACK 640
+
+#ifndef LOG_SPAN_SLOTS
+#define LOG_SPAN_SLOTS 16  // finished spans kept per thread before they are sent
+#endif
+
+#ifndef LOG_SPAN_DEPTH
+#define LOG_SPAN_DEPTH 8  // nested spans per thread
+#endif
+
+#ifndef LOG_SPAN_LEVEL
+#define LOG_SPAN_LEVEL LEVEL_INFO
+#endif
+
+#ifndef LOG_SPAN_PID
+#define LOG_SPAN_PID 1
+#endif
+
+#ifndef LOG_THREAD_LOCAL  // empty without thread-local storage: spans must then come from a single thread
+#if defined(__GNUC__) || defined(__clang__)
+#define LOG_THREAD_LOCAL __thread
+#else
+#define LOG_THREAD_LOCAL
+#endif
+#endif
+
+#ifndef LOG_METRICS_MAX_BUCKETS
+#define LOG_METRICS_MAX_BUCKETS 16  // histogram bounds; values above the last one are counted in the last bucket
+#endif
+
+#ifndef LOG_METRICS_LEVEL
+#define LOG_METRICS_LEVEL LEVEL_INFO
+#endif
+
+#ifndef LOG_SHM_STUCK_MS
+#define LOG_SHM_STUCK_MS 1000  // a slot claimed but not written for this long belongs to a crashed producer
+#endif
+
+#ifndef LOG_PROFILE_MAX_TOP
+#define LOG_PROFILE_MAX_TOP 10
+#endif
+
+#if defined(LOG_PROFILE) && defined(LOG_SOURCE_KEY)
+#define logJson(level, ...)                                                                  \
+  do {                                                                                       \
+    if (level >= LOG_MIN_LEVEL) {                                                            \
+      static LogSite log_site = {__FILE__ ":" TOSTRING(__LINE__), 0, 0, 0, 0, NULL};         \
+      log_json_site(&log_site, level, "", LOG_SOURCE_KEY, log_site.source, LOG_FUNC_KEY, __func__, \
+                    __VA_ARGS__, NULL);                                                      \
+    }                                                                                        \
+  } while (0)
+#elif defined(LOG_PROFILE)
+#define logJson(level, ...)                                                          \
+  do {                                                                               \
+    if (level >= LOG_MIN_LEVEL) {                                                    \
+      static LogSite log_site = {__FILE__ ":" TOSTRING(__LINE__), 0, 0, 0, 0, NULL}; \
+      log_json_site(&log_site, level, "", __VA_ARGS__, NULL);                        \
+    }                                                                                \
+  } while (0)
+#elif defined(LOG_SOURCE_KEY)
 #define logJson(level, ...) \
   if (level >= LOG_MIN_LEVEL) log_json(level, "", LOG_SOURCE_KEY, __FILE__ ":" TOSTRING(__LINE__), LOG_FUNC_KEY, __func__, __VA_ARGS__, NULL)
 #else
@@ -76,6 +177,28 @@ void logModifyForHuman(int level, char* json);
   if (level >= LOG_MIN_LEVEL) log_json(level, "", __VA_ARGS__, NULL)
 #endif
 
+// logSafe() can be called from signal handlers and interrupts: no heap, no stdio, no locks.
+// Records are queued and sent by logSafeFlush() later, or written by logSafeFlushFd() from a crash handler.
+// f#| values have the same significant digits as in log_json(), NaN and infinity are written as null.
+#ifdef LOG_SOURCE_KEY
+#define logSafe(level, ...) \
+  if (level >= LOG_MIN_LEVEL) log_json_safe(level, "", LOG_SOURCE_KEY, __FILE__ ":" TOSTRING(__LINE__), LOG_FUNC_KEY, __func__, __VA_ARGS__, NULL)
+#else
+#define logSafe(level, ...) \
+  if (level >= LOG_MIN_LEVEL) log_json_safe(level, "", __VA_ARGS__, NULL)
+#endif
+
+// static LogMetric requests = LOG_COUNTER("requests");
+// static const int32_t latency_bounds[] = {10, 100, 1000};
+// static int32_t latency_counts[4];  // one more than bounds, for values above the last bound
+// static LogMetric latency = LOG_HISTOGRAM("latency_ms", latency_bounds, latency_counts);
+#define LOG_COUNTER(name) {name, METRIC_COUNTER, 0, NULL, 0, NULL, NULL}
+#define LOG_GAUGE(name) {name, METRIC_GAUGE, 0, NULL, 0, NULL, NULL}
+#define LOG_HISTOGRAM(name, bounds, counts) \
+  {name, METRIC_HISTOGRAM, 0, bounds, sizeof(bounds) / sizeof(bounds[0]), counts, NULL}
+
+#define logBatch(batch, ...) log_batch(batch, __VA_ARGS__, NULL)  // same keys and types every time; only i|, f#| and b|
+
 #define STRINGIFY(x) #x
 #define TOSTRING(x) STRINGIFY(x)
 
@@ -93,9 +216,94 @@ int build_json(char* json, size_t buf_size, const char* item, ...);
 int vbuild_json(char* json, size_t buf_size, const char* item, va_list args);
 
 void log_json(int level, const char* placeholder, ...);
+void log_send(int level, const char* json, int len);  // sends a built json to all senders
+// Sends items in as many records of up to LOG_RECORD_MAX_BYTES as needed: prefix item,item,... suffix. Returns the
+// number of records. write_item() writes the next item and returns its length, < 0 when it doesn't fit in room (an
+// item too long even first in a record must be skipped), or 0 when there are no more items.
+int log_json_items(int level, const char* prefix, const char* suffix,
+                   int (*write_item)(void* ctx, char* json, int room, int8_t first), void* ctx);
+
+int log_json_safe(int level, const char* placeholder, ...);
+int logSafeFlush();  // not for signal handlers: sends the records queued by logSafe() through log_json()
+#if defined(__unix__) || defined(__APPLE__)
+int logSafeFlushFd(int fd);  // async-signal-safe: writes the queued records to fd with write(2), without time and id
+#endif
+
+// Cost of one logJson() call site, only collected with LOG_PROFILE
+typedef struct LogSite {
+  const char* source;  // file:line
+  uint32_t calls;
+  uint64_t bytes;
+  uint64_t build_ticks, send_ticks;  // in vbuild_json() and in senders
+  struct LogSite* next;
+} LogSite;
+
+#ifdef LOG_PROFILE
+extern uint32_t getLogProfileTicks();
+void log_json_site(LogSite* site, int level, const char* placeholder, ...);
+void log_profile_record(LogSite* site, uint32_t build_ticks, uint32_t send_ticks, int len);
+int logProfileReport(char* json, size_t buf_size, int top_n);  // [{"s":..,"n":..,"build":..,"send":..,"bytes":..}]
+void logProfileReset();
+#endif
+
+enum MetricType {
+  METRIC_COUNTER,    // sum of logMetricAdd() since the last flush
+  METRIC_GAUGE,      // last logMetricSet()
+  METRIC_HISTOGRAM,  // logMetricObserve() values per bucket since the last flush: values in (previous bound, bound],
+                     // the last bucket counts values above the last bound
+};
+
+typedef struct LogMetric {
+  const char* name;
+  enum MetricType type;
+  int32_t value;
+  const int32_t* bounds;
+  int32_t buckets;
+  int32_t* counts;
+  struct LogMetric* next;
+} LogMetric;
+
+// no formatting, only atomic operations: safe to call often and from several threads
+void logMetricAdd(LogMetric* metric, int32_t n);
+void logMetricSet(LogMetric* metric, int32_t value);
+void logMetricObserve(LogMetric* metric, int32_t value);
+int logMetricsFlush();  // sends all metrics in one record: {"requests":120,"queue":7,"latency_ms":[3,10,2,0]}
+int logMetricsPoll(uint32_t now_ms, uint32_t interval_ms);  // flushes every interval_ms
+
+#ifdef LOG_SPAN
+extern uint32_t getLogMicros();
+void logSpanBegin(const char* name);  // name must stay valid until the span is sent (string literals)
+void logSpanEnd();                    // ends the last begun span of this thread
+int logSpanFlush();  // sends this thread's finished spans: {"traceEvents":[{"name":..,"ph":"X","ts":..,"dur":..,..}]}
+#endif
+
+#ifdef LOG_SHM
+int logShmOpen(const char* name, int slots);  // creates the ring with 1 to 2^20 slots (rounded up to a power of 2, at least 2) or opens it
+void logShmClose();
+void logShmSend(int level, const char* json, int len);  // sender for producers, never blocks or makes syscalls
+int logShmDrain(int max_records);  // collector: sends up to max_records from the ring to its own senders
+#endif
 
 char* str_replace(char* orig, const char* rep, const char* with);
 
+// Collects records with the same keys into one {"key1":[...],"key2":[...]} record per flush
+typedef struct {
+  const char* items[LOG_BATCH_MAX_COLS];                  // prefixed keys of the first record, e.g. "i|n", "f5|x"
+  union {
+    double f[LOG_BATCH_MAX_ROWS];   // f#| columns
+    int32_t i[LOG_BATCH_MAX_ROWS];  // i| and b| columns
+  } values[LOG_BATCH_MAX_COLS];
+  int level, cols, rows, bytes, row_bytes, max_rows, max_bytes;
+  uint32_t max_ms, first_ms;
+  uint32_t (*now_ms)();
+} JsonBatch;
+
+// max_rows, max_bytes: 0 for the largest that fits; max_ms: 0 or now_ms NULL for no time limit
+void logBatchInit(JsonBatch* batch, int level, int max_rows, int max_bytes, uint32_t max_ms, uint32_t (*now_ms)());
+int logBatchFlush(JsonBatch* batch);
+int logBatchPoll(JsonBatch* batch);  // call periodically to flush on time when no record arrives
+int log_batch(JsonBatch* batch, const char* item, ...);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,29 @@
+#ifndef json_logger_hpp
+#define json_logger_hpp
+
+#include "JsonLogger.h"
+
+#ifdef LOG_SPAN
+
+// Times the enclosing scope: { logSpan("read sensor"); ... }
+class LogSpanScope {
+ public:
+  explicit LogSpanScope(const char* name) {
+    logSpanBegin(name);
+  }
+  ~LogSpanScope() {
+    logSpanEnd();
+  }
+
+ private:
+  LogSpanScope(const LogSpanScope&);
+  LogSpanScope& operator=(const LogSpanScope&);
+};
+
+#define LOG_SPAN_CONCAT(a, b) a##b
+#define LOG_SPAN_SCOPE(line) LOG_SPAN_CONCAT(log_span_, line)
+#define logSpan(name) LogSpanScope LOG_SPAN_SCOPE(__LINE__)(name)
+
+#endif
+
+#endif  // json_logger_hpp
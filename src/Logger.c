@@ -44,7 +44,7 @@ void logModifyForHuman(int level, char* mod) {
   str_replace(mod, "\"", " ");
 }
 
-void log_json(int level, const char* placeholder, ...) {
+static void vlog_json(LogSite* site, int level, va_list args) {
   char fragment[64], json[LOG_MAX_LEN];
   json(fragment, "-{",
 #ifdef LOG_TIME_KEY
@@ -54,10 +54,13 @@ void log_json(int level, const char* placeholder, ...) {
        LOG_ID_KEY, getLogId(),
 #endif
        "i|" LOG_LEVEL_KEY, level);
-  va_list args;
-  va_start(args, placeholder);
+#ifdef LOG_PROFILE
+  uint32_t start = getLogProfileTicks();
+#endif
   int len = vbuild_json(json, LOG_MAX_LEN, fragment, args);
-  va_end(args);
+#ifdef LOG_PROFILE
+  uint32_t built = getLogProfileTicks();
+#endif
 
   for (int i = 0; i < number_of_senders; i++) {
     if (len < 0) {
@@ -67,8 +70,75 @@ void log_json(int level, const char* placeholder, ...) {
     }
     senders[i](level, json, len);
   }
+
+#ifdef LOG_PROFILE
+  if (site) {
+    log_profile_record(site, built - start, getLogProfileTicks() - built, len);
+  }
+#else
+  (void)site;
+#endif
+}
+
+void log_send(int level, const char* json, int len) {
+  for (int i = 0; i < number_of_senders; i++) {
+    senders[i](level, json, len);
+  }
 }
 
+void log_json(int level, const char* placeholder, ...) {
+  va_list args;
+  va_start(args, placeholder);
+  vlog_json(NULL, level, args);
+  va_end(args);
+}
+
+int log_json_items(int level, const char* prefix, const char* suffix,
+                   int (*write_item)(void* ctx, char* json, int room, int8_t first), void* ctx) {
+  char json[LOG_MAX_LEN];
+  int prefix_len = 2 + strlen(prefix);
+  int suffix_len = strlen(suffix);
+  int records = 0;
+  if (prefix_len + suffix_len >= LOG_RECORD_MAX_BYTES) {
+    return JSON_ERR_BUF_SIZE;
+  }
+  for (int8_t more = 1; more;) {
+    int len = prefix_len;
+    int items = 0;
+    memcpy(json, "+|", 2);
+    memcpy(&json[2], prefix, prefix_len - 2);
+    for (;;) {
+      int comma = items > 0;
+      int room = LOG_RECORD_MAX_BYTES - suffix_len - len - comma;
+      int n = write_item(ctx, &json[len + comma], room > 0 ? room : 0, items == 0);
+      if (n <= 0) {
+        more = n < 0;
+        break;
+      }
+      if (comma) {
+        json[len] = ',';
+      }
+      len += comma + n;
+      items++;
+    }
+    if (items > 0) {
+      memcpy(&json[len], suffix, suffix_len + 1);
+      log_json(level, "", json, NULL);
+      records++;
+    }
+  }
+  return records;
+}
+
+#ifdef LOG_PROFILE
+void log_json_site(LogSite* site, int level, const char* placeholder, ...) {
+  va_list args;
+  va_start(args, placeholder);
+  vlog_json(site, level, args);
+  va_end(args);
+}
+#endif
+
 #ifdef LOGGER_TEST
 
 // gcc -Os -DLOGGER_TEST '-DLOG_ID_KEY="i"' '-DLOG_TIME_KEY="t"' '-DLOG_SOURCE_KEY="s"' src/*.c; ./a.out; rm ./a.out
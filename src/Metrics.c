@@ -0,0 +1,177 @@
+#include "JsonLogger.h"
+
+static LogMetric end;  // metrics are listed when next is set
+static LogMetric* metrics = &end;
+static uint32_t last_flush_ms = 0;
+
+// first update of a metric adds it to the list
+static void add_metric(LogMetric* metric) {
+  LogMetric* expected = NULL;
+  if (!__atomic_compare_exchange_n(&metric->next, &expected, &end, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    return;  // already listed
+  }
+  LogMetric* head = __atomic_load_n(&metrics, __ATOMIC_ACQUIRE);
+  do {
+    __atomic_store_n(&metric->next, head, __ATOMIC_RELAXED);
+  } while (!__atomic_compare_exchange_n(&metrics, &head, metric, 1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+}
+
+#define listMetric(metric)                                   \
+  do {                                                       \
+    if (!__atomic_load_n(&(metric)->next, __ATOMIC_ACQUIRE)) { \
+      add_metric(metric);                                    \
+    }                                                        \
+  } while (0)
+
+void logMetricAdd(LogMetric* metric, int32_t n) {
+  listMetric(metric);
+  __atomic_fetch_add(&metric->value, n, __ATOMIC_RELAXED);
+}
+
+void logMetricSet(LogMetric* metric, int32_t value) {
+  listMetric(metric);
+  __atomic_store_n(&metric->value, value, __ATOMIC_RELAXED);
+}
+
+void logMetricObserve(LogMetric* metric, int32_t value) {
+  listMetric(metric);
+  int32_t i = 0;
+  while (i < metric->buckets && i < LOG_METRICS_MAX_BUCKETS && value > metric->bounds[i]) {
+    i++;
+  }
+  __atomic_fetch_add(&metric->counts[i], 1, __ATOMIC_RELAXED);
+}
+
+// writes "name":value of the metric ctx points to and moves it to the next one
+static int write_metric(void* ctx, char* json, int room, int8_t first) {
+  LogMetric** next = (LogMetric**)ctx;
+  LogMetric* metric = *next;
+  if (metric == &end) {
+    return 0;
+  }
+  int32_t counts[LOG_METRICS_MAX_BUCKETS + 1];
+  int value_len = JSON_ERR_BUF_SIZE;
+  int n = snprintf(json, room, "\"%s\":", metric->name);
+  if (n >= 0 && n < room && metric->type == METRIC_HISTOGRAM) {
+    int32_t buckets = (metric->buckets < LOG_METRICS_MAX_BUCKETS ? metric->buckets : LOG_METRICS_MAX_BUCKETS) + 1;
+    for (int32_t i = 0; i < buckets; i++) {
+      counts[i] = __atomic_load_n(&metric->counts[i], __ATOMIC_RELAXED);
+    }
+    value_len = build_json(&json[n], room - n, "i[", buckets, counts, NULL);
+    if (value_len >= 0) {  // it fits: take the counts, keeping what came in since we read them
+      for (int32_t i = 0; i < buckets; i++) {
+        __atomic_fetch_sub(&metric->counts[i], counts[i], __ATOMIC_RELAXED);
+      }
+    }
+  } else if (n >= 0 && n < room) {
+    int32_t value = __atomic_load_n(&metric->value, __ATOMIC_RELAXED);
+    value_len = snprintf(&json[n], room - n, "%" PRId32, value);
+    if (value_len >= room - n) {
+      value_len = JSON_ERR_BUF_SIZE;
+    } else if (metric->type == METRIC_COUNTER) {
+      __atomic_fetch_sub(&metric->value, value, __ATOMIC_RELAXED);
+    }
+  }
+  if (value_len >= 0 || first) {  // too long even on its own: skipped
+    *next = metric->next;
+  }
+  return value_len < 0 ? value_len : n + value_len;
+}
+
+int logMetricsFlush() {
+  LogMetric* next = __atomic_load_n(&metrics, __ATOMIC_ACQUIRE);
+  return log_json_items(LOG_METRICS_LEVEL, "", "", write_metric, &next);
+}
+
+int logMetricsPoll(uint32_t now_ms, uint32_t interval_ms) {
+  if (now_ms - last_flush_ms < interval_ms) {
+    return 0;
+  }
+  last_flush_ms = now_ms;
+  return logMetricsFlush();
+}
+
+#ifdef METRICS_TEST
+// gcc -Os -DMETRICS_TEST src/*.c -lpthread; ./a.out; rm ./a.out
+
+#include <assert.h>
+#include <pthread.h>
+
+static char sent[LOG_MAX_LEN];
+static int sent_count = 0;
+
+void send_capture(int level, const char* json, int len) {
+  printf("%s\n", json);
+  assert(len == strlen(json));
+  memcpy(sent, json, len + 1);
+  sent_count++;
+}
+
+static LogMetric requests = LOG_COUNTER("requests");
+static LogMetric queue = LOG_GAUGE("queue");
+static const int32_t latency_bounds[] = {10, 100, 1000};
+static int32_t latency_counts[4];
+static LogMetric latency = LOG_HISTOGRAM("latency_ms", latency_bounds, latency_counts);
+
+static void* work(void* arg) {
+  for (int32_t i = 0; i < 100000; i++) {
+    logMetricAdd(&requests, 1);
+    logMetricSet(&queue, i);
+    logMetricObserve(&latency, i % 2000);
+  }
+  return NULL;
+}
+
+int main() {
+  logAddSender(send_capture);
+  assert(logMetricsFlush() == 0);
+
+  logMetricAdd(&requests, 2);
+  logMetricAdd(&requests, 3);
+  logMetricSet(&queue, 7);
+  logMetricSet(&queue, 4);
+  int32_t samples[] = {-5, 10, 11, 100, 101, 1000, 1001, 5000};
+  for (int i = 0; i < 8; i++) {
+    logMetricObserve(&latency, samples[i]);
+  }
+  assert(logMetricsFlush() == 1);
+  assert(!strcmp(sent, "{\"l\":2,\"latency_ms\":[2,2,2,2],\"queue\":4,\"requests\":5}"));
+
+  // counters and histograms start over, gauges keep their value
+  assert(logMetricsFlush() == 1);
+  assert(!strcmp(sent, "{\"l\":2,\"latency_ms\":[0,0,0,0],\"queue\":4,\"requests\":0}"));
+
+  // interval
+  sent_count = 0;
+  assert(logMetricsPoll(1000, 1000) == 1);
+  assert(logMetricsPoll(1999, 1000) == 0);
+  assert(logMetricsPoll(2000, 1000) == 1);
+  assert(sent_count == 2);
+
+  // updates from several threads at the same time
+  pthread_t threads[4];
+  for (int i = 0; i < 4; i++) {
+    pthread_create(&threads[i], NULL, work, NULL);
+  }
+  for (int i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  assert(logMetricsFlush() == 1);
+  assert(!strcmp(sent, "{\"l\":2,\"latency_ms\":[2200,18000,180000,199800],\"queue\":99999,\"requests\":400000}"));
+
+  // too many metrics for one record
+  static LogMetric many[40];
+  static char names[40][16];
+  for (int i = 0; i < 40; i++) {
+    sprintf(names[i], "metric_%d", i);
+    many[i] = (LogMetric)LOG_COUNTER(names[i]);
+    logMetricAdd(&many[i], i);
+  }
+  sent_count = 0;
+  assert(logMetricsFlush() > 1);
+  assert(sent_count > 1);
+  assert(strstr(sent, "\"requests\":0"));
+
+  return 0;
+}
+#endif
@@ -0,0 +1,163 @@
+#include "JsonLogger.h"
+
+#ifdef LOG_PROFILE
+
+static LogSite end;  // sites are listed when next is set
+static LogSite* sites = &end;
+
+#define load(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define siteTicks(site) (load((site)->build_ticks) + load((site)->send_ticks))
+
+void log_profile_record(LogSite* site, uint32_t build_ticks, uint32_t send_ticks, int len) {
+  LogSite* expected = NULL;
+  if (!__atomic_load_n(&site->next, __ATOMIC_ACQUIRE) &&
+      __atomic_compare_exchange_n(&site->next, &expected, &end, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    LogSite* head = __atomic_load_n(&sites, __ATOMIC_ACQUIRE);  // first call of this site
+    do {
+      __atomic_store_n(&site->next, head, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&sites, &head, site, 1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+  }
+  // a call site can be shared by threads, like metrics
+  __atomic_fetch_add(&site->calls, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&site->build_ticks, build_ticks, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&site->send_ticks, send_ticks, __ATOMIC_RELAXED);
+  if (len > 0) {
+    __atomic_fetch_add(&site->bytes, len, __ATOMIC_RELAXED);
+  }
+}
+
+void logProfileReset() {
+  for (LogSite* site = __atomic_load_n(&sites, __ATOMIC_ACQUIRE); site != &end; site = site->next) {
+    __atomic_store_n(&site->calls, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&site->bytes, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&site->build_ticks, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&site->send_ticks, 0, __ATOMIC_RELAXED);
+  }
+}
+
+int logProfileReport(char* json, size_t buf_size, int top_n) {
+  LogSite* top[LOG_PROFILE_MAX_TOP];
+  int count = 0;
+  if (top_n > LOG_PROFILE_MAX_TOP) {
+    top_n = LOG_PROFILE_MAX_TOP;
+  }
+
+  // keep the top_n most expensive sites, sorted by ticks
+  for (LogSite* site = __atomic_load_n(&sites, __ATOMIC_ACQUIRE); site != &end; site = site->next) {
+    if (load(site->calls) == 0) {
+      continue;
+    }
+    int i = count < top_n ? count++ : top_n;
+    for (; i > 0 && siteTicks(top[i - 1]) < siteTicks(site); i--) {
+      if (i < top_n) {
+        top[i] = top[i - 1];
+      }
+    }
+    if (i < top_n) {
+      top[i] = site;
+    }
+  }
+
+  if (!json || buf_size < 3) {
+    return JSON_ERR_BUF_SIZE;
+  }
+  json[0] = '[';
+  size_t len = 1;
+  for (int i = 0; i < count; i++) {
+    if (i > 0) {
+      json[len++] = ',';
+    }
+    int n = build_json(&json[len], buf_size - len, "s", top[i]->source, "fh|n", (double)load(top[i]->calls),
+                       "fh|build", (double)load(top[i]->build_ticks), "fh|send", (double)load(top[i]->send_ticks),
+                       "fh|bytes", (double)load(top[i]->bytes), NULL);
+    if (n < 0) {
+      return n;
+    }
+    len += n;
+    if (len + 2 > buf_size) {
+      return JSON_ERR_BUF_SIZE;
+    }
+  }
+  json[len++] = ']';
+  json[len] = '\0';
+  return len;
+}
+
+#ifdef PROFILE_TEST
+// gcc -Os -DPROFILE_TEST -DLOG_PROFILE src/*.c; ./a.out; rm ./a.out
+// gcc -Os -DPROFILE_TEST -DLOG_PROFILE '-DLOG_SOURCE_KEY="s"' src/*.c; ./a.out; rm ./a.out
+
+#include <assert.h>
+
+static uint32_t ticks = 0;
+static int sent_bytes = 0;
+
+uint32_t getLogProfileTicks() {
+  return ticks += 10;  // every measurement costs 10 ticks
+}
+
+void send_slow(int level, const char* json, int len) {
+  ticks += 1000;
+}
+
+void send_fast(int level, const char* json, int len) {
+  sent_bytes += len;
+}
+
+int main() {
+  char buf256[256], expected[256], buf64[64];
+
+  logAddSender(send_fast);
+  int loopLine = __LINE__ + 2;
+  for (int i = 0; i < 3; i++) {
+    logInfo("i|i", i);
+  }
+  int loopBytes = sent_bytes;
+  logInfo("once");
+  logAddSender(send_slow);
+  sent_bytes = 0;
+  int slowLine = __LINE__ + 1;
+  logWarn("slow");
+  int slowBytes = sent_bytes;
+
+  int len = logProfileReport(buf256, sizeof(buf256), 2);
+  printf("%s\n", buf256);
+  sprintf(expected, "[{\"s\":\"%s:%d\",\"n\":1,\"build\":10,\"send\":1010,\"bytes\":%d},\
+{\"s\":\"%s:%d\",\"n\":3,\"build\":30,\"send\":30,\"bytes\":%d}]",
+          __FILE__, slowLine, slowBytes, __FILE__, loopLine, loopBytes);
+  assert(!strcmp(buf256, expected));
+  assert(len == strlen(buf256));
+
+  logProfileReset();
+  sent_bytes = 0;
+  int onceLine = __LINE__ + 1;
+  logInfo("once");
+  int onceBytes = sent_bytes;
+  len = logProfileReport(buf256, sizeof(buf256), LOG_PROFILE_MAX_TOP + 1);
+  printf("%s\n", buf256);
+  sprintf(expected, "[{\"s\":\"%s:%d\",\"n\":1,\"build\":10,\"send\":1010,\"bytes\":%d}]", __FILE__, onceLine,
+          onceBytes);
+  assert(!strcmp(buf256, expected));
+  assert(len == strlen(buf256));
+
+  // counts past 2^31
+  sites->calls = 3000000000u;
+  sites->bytes = 3000000000u;
+  logProfileReport(buf256, sizeof(buf256), 1);
+  printf("%s\n", buf256);
+  assert(strstr(buf256, "\"n\":3000000000,") && strstr(buf256, "\"bytes\":3000000000}"));
+
+  logProfileReset();
+  len = logProfileReport(buf64, sizeof(buf64), 5);
+  assert(!strcmp(buf64, "[]"));
+  assert(len == 2);
+
+  logInfo("once");
+  len = logProfileReport(buf64, 20, 5);
+  assert(len == JSON_ERR_BUF_SIZE);
+
+  return 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,614 @@
+#include "JsonLogger.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+// Everything here must stay async-signal-safe: no heap, no stdio, no locks and no unbounded loops.
+
+#define SAFE_MASK (LOG_SAFE_SLOTS - 1)
+#define SAFE_MAX (LOG_SAFE_LEN - 1)  // leaves room for '\0'
+
+typedef struct {
+  uint32_t seq;  // lap (position without slot index): free to claim, lap + 1: written, lap + slots: free for next lap
+  int32_t level;
+  int32_t len;
+  char json[LOG_SAFE_LEN];  // a fragment: +|"key":value,...
+} SafeSlot;
+
+static SafeSlot slots[LOG_SAFE_SLOTS];
+static uint32_t head = 0;  // next position writers claim
+static uint32_t tail = 0;  // next position logSafeFlush() reads
+static uint32_t dropped = 0;
+
+static int put_raw(char* json, int len, const char* s) {
+  for (; len >= 0 && *s; s++) {
+    if (len >= SAFE_MAX) {
+      return JSON_ERR_BUF_SIZE;
+    }
+    json[len++] = *s;
+  }
+  return len;
+}
+
+// same escaping as addStr() in Builder.c
+static int put_str(char* json, int len, const char* s) {
+  if (!s) {
+    return put_raw(json, len, "null");
+  }
+  len = put_raw(json, len, "\"");
+  for (; len >= 0 && *s; s++) {
+    char escaped = 0;
+    switch (*s) {
+      case '\\':
+        escaped = '\\';
+        break;
+      case '\n':
+        escaped = 'n';
+        break;
+      case '"':
+        escaped = '"';
+        break;
+      case '\b':
+        escaped = 'b';
+        break;
+      case '\f':
+        escaped = 'f';
+        break;
+      case '\r':
+        escaped = 'r';
+        break;
+      case '\t':
+        escaped = 't';
+        break;
+    }
+    if (len + (escaped ? 2 : 1) > SAFE_MAX) {
+      return JSON_ERR_BUF_SIZE;
+    }
+    if (escaped) {
+      json[len++] = '\\';
+      json[len++] = escaped;
+    } else {
+      json[len++] = *s;
+    }
+  }
+  return put_raw(json, len, "\"");
+}
+
+// writes u with at least width digits, padding with leading zeros
+static int put_digits(char* json, int len, uint64_t u, int width) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + u % 10;
+    u /= 10;
+  } while (u || n < width);
+  while (len >= 0 && n > 0) {
+    if (len >= SAFE_MAX) {
+      return JSON_ERR_BUF_SIZE;
+    }
+    json[len++] = digits[--n];
+  }
+  return len;
+}
+
+static int put_int(char* json, int len, int32_t value) {
+  if (value < 0) {
+    len = put_raw(json, len, "-");
+  }
+  return put_digits(json, len, value < 0 ? 0u - (uint32_t)value : (uint32_t)value, 1);
+}
+
+// addDouble()'s "%.*g" without sprintf: precisionChar significant digits, exponent below 1e-4 and from 1e<digits> on
+static int put_double(char* json, int len, double value, char precisionChar) {
+  if (value != value || value - value != 0) {  // NaN or infinity
+    return put_raw(json, len, "null");
+  }
+  uint8_t digits = precisionChar >= 'a' ? precisionChar - 'a' + 10 : precisionChar - '0';
+  if (digits > 17) {
+    digits = 17;
+  } else if (digits == 0) {
+    digits = 1;
+  }
+  if (value < 0) {
+    len = put_raw(json, len, "-");
+    value = -value;
+  }
+  if (value == 0) {
+    return put_raw(json, len, "0");
+  }
+
+  // value = mantissa * 10^exponent with mantissa in [1, 10): at most 20 + 9 + 20 + 9 steps
+  double mantissa = value;
+  int32_t exponent = 0;
+  for (; mantissa >= 1e16; exponent += 16) {
+    mantissa /= 1e16;
+  }
+  for (; mantissa >= 10; exponent++) {
+    mantissa /= 10;
+  }
+  for (; mantissa < 1e-16; exponent -= 16) {
+    mantissa *= 1e16;
+  }
+  for (; mantissa < 1; exponent--) {
+    mantissa *= 10;
+  }
+  uint64_t scale = 1;  // 10^(digits - 1)
+  for (uint8_t i = 1; i < digits; i++) {
+    scale *= 10;
+  }
+
+  // significand = value * 10^shift, rounded once with an exact power of 10 when there is one
+  int32_t shift = digits - 1 - exponent;
+  double scaled = mantissa * scale;
+  if (shift >= -22 && shift <= 22) {
+    double power = 1;
+    for (int32_t i = 0; i < shift || i < -shift; i++) {
+      power *= 10;
+    }
+    scaled = shift >= 0 ? value * power : value / power;
+  }
+  uint64_t significand = (uint64_t)scaled;
+  double rest = scaled - significand;
+  if (rest > 0.5 || (rest == 0.5 && (significand & 1))) {  // to nearest, ties to even like printf
+    significand++;
+  }
+  if (significand >= scale * 10) {  // rounded up to the next power of 10
+    significand /= 10;
+    exponent++;
+  }
+  int32_t precision = digits;
+  for (; digits > 1 && significand % 10 == 0; digits--) {
+    significand /= 10;
+    scale /= 10;
+  }
+
+  if (exponent < -4 || exponent >= precision) {
+    len = put_digits(json, len, significand / scale, 1);
+    if (digits > 1) {
+      len = put_raw(json, len, ".");
+      len = put_digits(json, len, significand % scale, digits - 1);
+    }
+    len = put_raw(json, len, exponent < 0 ? "e-" : "e+");
+    return put_digits(json, len, exponent < 0 ? -exponent : exponent, 2);
+  }
+  if (exponent < 0) {  // 0.000ddd
+    len = put_raw(json, len, "0.");
+    return put_digits(json, len, significand, digits - exponent - 1);
+  }
+  if (exponent + 1 >= digits) {  // ddd000
+    len = put_digits(json, len, significand, 1);
+    for (int32_t i = digits; len >= 0 && i <= exponent; i++) {
+      len = put_raw(json, len, "0");
+    }
+    return len;
+  }
+  for (int32_t i = 0; i < exponent; i++) {  // ddd.ddd
+    scale /= 10;
+  }
+  len = put_digits(json, len, significand / scale, 1);
+  len = put_raw(json, len, ".");
+  return put_digits(json, len, significand % scale, digits - exponent - 1);
+}
+
+static int put_key(char* json, int len, const char* key) {
+  len = put_raw(json, len, "\"");
+  len = put_raw(json, len, key);
+  return put_raw(json, len, "\":");
+}
+
+// vbuild_json() without heap and stdio, writing a fragment for log_json()
+static int safe_build(char* json, va_list arg) {
+  int len = put_raw(json, 0, "+|");
+  int8_t firstItem = 1;
+  int braceDiff = 0;
+  const char* item = va_arg(arg, const char*);
+
+  while (item && len >= 0) {
+    int8_t isFragment = (item[0] == '+' && item[1] == '|');
+    int8_t isEndObject = (item[0] == '}' && item[1] == '|');
+    if (isFragment && item[2] == '\0') {
+      item = va_arg(arg, const char*);
+      continue;
+    }
+    if (!firstItem && !isEndObject) {
+      len = put_raw(json, len, ",");
+    }
+    firstItem = 0;
+
+    if (item[1] == '|' && item[0] == 'i') {  // integer
+      len = put_key(json, len, &item[2]);
+      len = put_int(json, len, va_arg(arg, int32_t));
+    } else if (item[2] == '|' && item[0] == 'f') {  // double: no sprintf here
+      len = put_key(json, len, &item[3]);
+      len = put_double(json, len, va_arg(arg, double), item[1]);
+    } else if (item[1] == '|' && item[0] == 'b') {  // boolean
+      len = put_key(json, len, &item[2]);
+      len = put_raw(json, len, va_arg(arg, int32_t) ? "true" : "false");
+    } else if (item[1] == '|' && item[0] == 'o') {  // others
+      len = put_key(json, len, &item[2]);
+      const char* value = va_arg(arg, const char*);
+      len = put_raw(json, len, value ? value : "null");
+    } else if (item[1] == '|' && item[0] == '{') {  // begin object
+      len = put_key(json, len, &item[2]);
+      len = put_raw(json, len, "{");
+      firstItem = 1;
+      braceDiff += 1;
+    } else if (isEndObject) {  // end object
+      if (braceDiff < 1) {
+        return JSON_ERR_BRACES_MISMATCH;
+      }
+      len = put_raw(json, len, "}");
+      braceDiff -= 1;
+    } else if (isFragment) {  // insert fragment
+      len = put_raw(json, len, &item[2]);
+    } else if ((item[1] == '[' && (item[0] == 'i' || item[0] == 'b' || item[0] == 'o' || item[0] == 's')) ||
+               (item[2] == '[' && item[0] == 'f')) {  // array: every element writes at least a byte, so it's bounded
+      const char* arrayKey = item[0] == 'f' ? &item[3] : &item[2];
+      if (*arrayKey != '\0') {  // no key: bare [...] like the builder
+        len = put_key(json, len, arrayKey);
+      }
+      int32_t numOfArrayItems = va_arg(arg, int32_t);
+      const void* list = va_arg(arg, const void*);
+      len = put_raw(json, len, "[");
+      for (int32_t i = 0; len >= 0 && i < numOfArrayItems; i++) {
+        if (i != 0) {
+          len = put_raw(json, len, ",");
+        }
+        switch (item[0]) {
+          case 'i':
+            len = put_int(json, len, ((const int32_t*)list)[i]);
+            break;
+          case 'b':
+            len = put_raw(json, len, ((const int32_t*)list)[i] ? "true" : "false");
+            break;
+          case 'o':
+            len = put_raw(json, len, ((const char**)list)[i] ? ((const char**)list)[i] : "null");
+            break;
+          case 'f':
+            len = put_double(json, len, ((const double*)list)[i], item[1]);
+            break;
+          default:
+            len = put_str(json, len, ((const char**)list)[i]);
+            break;
+        }
+      }
+      len = put_raw(json, len, "]");
+    } else {  // string
+      const char* value = va_arg(arg, const char*);
+      if (!value) {
+        len = put_key(json, len, EMPTY_KEY);
+        len = put_str(json, len, item);
+        break;
+      }
+      len = put_key(json, len, (item[1] == '|' && item[0] == 's') ? item + 2 : item);
+      len = put_str(json, len, value);
+    }
+    item = va_arg(arg, const char*);
+  }
+
+  if (len < 0) {
+    return len;
+  }
+  if (braceDiff != 0) {
+    return JSON_ERR_BRACES_MISMATCH;
+  }
+  json[len] = '\0';
+  return len;
+}
+
+int log_json_safe(int level, const char* placeholder, ...) {
+  uint32_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+  SafeSlot* slot;
+  for (int retry = 0;; retry++) {
+    slot = &slots[pos & SAFE_MASK];
+    int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (pos & ~SAFE_MASK));
+    if (diff < 0 || retry > LOG_SAFE_RETRIES) {  // full, or too busy
+      __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+      return JSON_ERR_BUF_SIZE;
+    }
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&head, &pos, pos + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else {
+      pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    }
+  }
+
+  va_list args;
+  va_start(args, placeholder);
+  int len = safe_build(slot->json, args);
+  va_end(args);
+  slot->level = level;
+  slot->len = len;
+  __atomic_store_n(&slot->seq, (pos & ~SAFE_MASK) + 1, __ATOMIC_RELEASE);
+  return len < 0 ? len : 0;
+}
+
+int logSafeFlush() {
+  int count = 0;
+  for (;; tail++, count++) {
+    SafeSlot* slot = &slots[tail & SAFE_MASK];
+    uint32_t lap = tail & ~SAFE_MASK;
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != lap + 1) {
+      break;
+    }
+    if (slot->len < 0) {
+      log_json(LEVEL_ERROR, "", "i|len", slot->len, "safe_build() failed in log_json_safe()", NULL);
+    } else {
+      log_json(slot->level, "", slot->json, NULL);
+    }
+    __atomic_store_n(&slot->seq, lap + LOG_SAFE_SLOTS, __ATOMIC_RELEASE);
+  }
+
+  uint32_t lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+  if (lost) {
+    log_json(LEVEL_WARN, "", "i|dropped", (int32_t)lost, "log records dropped by log_json_safe()", NULL);
+  }
+  return count;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+// one line of JSON from a fragment, as log_json() would build it without time and id
+static int write_record(int fd, int level, const char* fragment) {
+  char line[sizeof("{\"" LOG_LEVEL_KEY "\":-2147483648,}\n") + LOG_SAFE_LEN];
+  int len = put_raw(line, 0, "{\"" LOG_LEVEL_KEY "\":");
+  len = put_int(line, len, level);
+  size_t n = strlen(fragment);
+  if (len < 0 || n > SAFE_MAX) {
+    return JSON_ERR_BUF_SIZE;
+  }
+  if (n > 0) {
+    line[len++] = ',';
+    memcpy(&line[len], fragment, n);
+    len += n;
+  }
+  line[len++] = '}';
+  line[len++] = '\n';
+  return write(fd, line, len) == len ? 0 : JSON_ERR_BUF_SIZE;
+}
+
+int logSafeFlushFd(int fd) {
+  char fragment[LOG_SAFE_LEN];
+  int count = 0;
+  for (;; tail++, count++) {
+    SafeSlot* slot = &slots[tail & SAFE_MASK];
+    uint32_t lap = tail & ~SAFE_MASK;
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != lap + 1) {
+      break;
+    }
+    if (slot->len < 0) {
+      int len = put_raw(fragment, 0, "\"len\":");
+      len = put_int(fragment, len, slot->len);
+      len = put_raw(fragment, len, ",\"" EMPTY_KEY "\":\"safe_build() failed in log_json_safe()\"");
+      if (len >= 0) {
+        fragment[len] = '\0';
+        write_record(fd, LEVEL_ERROR, fragment);
+      }
+    } else {
+      write_record(fd, slot->level, &slot->json[2]);  // after "+|"
+    }
+    __atomic_store_n(&slot->seq, lap + LOG_SAFE_SLOTS, __ATOMIC_RELEASE);
+  }
+
+  uint32_t lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+  if (lost) {
+    int len = put_raw(fragment, 0, "\"dropped\":");
+    len = put_int(fragment, len, (int32_t)lost);
+    len = put_raw(fragment, len, ",\"" EMPTY_KEY "\":\"log records dropped by log_json_safe()\"");
+    if (len >= 0) {
+      fragment[len] = '\0';
+      write_record(fd, LEVEL_WARN, fragment);
+    }
+  }
+  return count;
+}
+#endif
+
+#ifdef SAFE_TEST
+// gcc -Os -DSAFE_TEST src/*.c; ./a.out; rm ./a.out
+
+#include <assert.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+static char sent[LOG_MAX_LEN];
+static int received = 0, missing = 0;
+
+void send_capture(int level, const char* json, int len) {
+  const char* d = strstr(json, "\"dropped\":");
+  if (d) {
+    missing += atoi(d + 10);
+    return;
+  }
+  assert(len == strlen(json));
+  memcpy(sent, json, len + 1);
+  received++;
+}
+
+static void safe_equals_json(const char* expected) {
+  assert(logSafeFlush() == 1);
+  printf("%s\n%s\n", sent, expected);
+  fflush(stdout);
+  assert(!strcmp(sent, expected));
+}
+
+static void on_alarm(int sig) {
+  logSafe(LEVEL_ERROR, "i|sig", sig, "from handler");
+}
+
+// stack use of log_json_safe() on an alternate stack
+static char alt_stack[65536];
+static char* handler_sp;
+
+static void on_usr1(int sig) {
+  char marker;
+  handler_sp = &marker;
+  char* strArray[] = {"\\\n\b\t\r\f\"", NULL};
+  int32_t intArray[] = {-2147483647 - 1, 2147483647};
+  log_json_safe(LEVEL_FATAL, "", "{|o", "i|sig", sig, "s[s", 2, strArray, "i[i", 2, intArray, "}|", "fh|f", 1.23e-300,
+                "crash", NULL);
+}
+
+static long elapsed_ns(struct timespec* start) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  return (end.tv_sec - start->tv_sec) * 1000000000L + end.tv_nsec - start->tv_nsec;
+}
+
+static int compare_long(const void* a, const void* b) {
+  return *(const long*)a < *(const long*)b ? -1 : *(const long*)a > *(const long*)b;
+}
+
+int main() {
+  char buf256[256];
+  logAddSender(send_capture);
+
+  // same json as the builder
+  char* strArray[] = {"StrV3", "Str\"V4\""};
+  int32_t intArray[] = {0, -2147483648, 2147483647};
+  int32_t boolArray[] = {0, 1};
+  json(buf256, "i|l", LEVEL_INFO, "StrK", "StrV", "{|ObjK", "i|IntK", 0xffffffff, "}|", "b|BoolK", 1, "o|NullK", "null",
+       "s|i|k", "\\\n\b\t\r\f\"", "ValueOnly");
+  logSafe(LEVEL_INFO, "StrK", "StrV", "{|ObjK", "i|IntK", 0xffffffff, "}|", "b|BoolK", 1, "o|NullK", "null", "s|i|k",
+          "\\\n\b\t\r\f\"", "ValueOnly");
+  safe_equals_json(buf256);
+
+  json(buf256, "i|l", LEVEL_INFO, "s[StrArrayK", 2, strArray, "i[IntArrayK", 3, intArray, "b[BoolArrayK", 2, boolArray);
+  logSafe(LEVEL_INFO, "s[StrArrayK", 2, strArray, "i[IntArrayK", 3, intArray, "b[BoolArrayK", 2, boolArray);
+  safe_equals_json(buf256);
+
+  logSafe(LEVEL_INFO, "f5|pi", 3.14159, "+|\"raw\":1", "{|empty", "}|");
+  safe_equals_json("{\"l\":2,\"pi\":3.1416,\"raw\":1,\"empty\":{}}");
+
+  // doubles with the builder's significant digits, NaN and infinity as null
+  double doubleArray[] = {-0.126, 2.0, 0.05, 1.5e20, 12.5, 99999.5, 1e-5};
+  json(buf256, "i|l", LEVEL_INFO, "f2[x", 7, doubleArray, "f5|tiny", 1.23e-7, "f0|n", 2.5, "fa|min", -2147483648.0);
+  logSafe(LEVEL_INFO, "f2[x", 7, doubleArray, "f5|tiny", 1.23e-7, "f0|n", 2.5, "fa|min", -2147483648.0);
+  safe_equals_json(buf256);
+  double zero = 0;
+  logSafe(LEVEL_INFO, "f5|nan", 0 / zero, "f5|inf", -1 / zero);
+  safe_equals_json("{\"l\":2,\"nan\":null,\"inf\":null}");
+
+  // no key: a bare array like the builder's
+  assert(log_json_safe(LEVEL_INFO, "", "i[", 3, intArray, NULL) == 0);
+  assert(!strcmp(slots[(head - 1) & SAFE_MASK].json, "+|[0,-2147483648,2147483647]"));
+  logSafeFlush();
+
+  // full queue
+  received = missing = 0;
+  for (int i = 0; i < LOG_SAFE_SLOTS + 2; i++) {
+    logSafe(LEVEL_INFO, "i|i", i);
+  }
+  assert(logSafeFlush() == LOG_SAFE_SLOTS);
+  assert(received == LOG_SAFE_SLOTS && missing == 2);
+  char last[32];
+  sprintf(last, "{\"l\":2,\"i\":%d}", LOG_SAFE_SLOTS - 1);
+  assert(!strcmp(sent, last));
+
+  // errors
+  assert(log_json_safe(LEVEL_INFO, "", "}|", NULL) == JSON_ERR_BRACES_MISMATCH);
+  assert(logSafeFlush() == 1);
+  assert(strstr(sent, "\"len\":-2"));
+
+  // bounded reads: a string without '\0' running into a page we can't read
+  long page = sysconf(_SC_PAGESIZE);
+  char* pages = mmap(NULL, page * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  assert(pages != MAP_FAILED);
+  mprotect(pages + page, page, PROT_NONE);
+  memset(pages, 'x', page);
+  assert(log_json_safe(LEVEL_INFO, "", &pages[page - LOG_SAFE_LEN * 2], NULL) == JSON_ERR_BUF_SIZE);
+  assert(log_json_safe(LEVEL_INFO, "", "k", &pages[0], NULL) == JSON_ERR_BUF_SIZE);
+  munmap(pages, page * 2);
+  assert(logSafeFlush() == 2);
+
+  // stack
+  stack_t ss = {.ss_sp = alt_stack, .ss_size = sizeof(alt_stack)};
+  assert(sigaltstack(&ss, NULL) == 0);
+  struct sigaction sa = {0};
+  sa.sa_handler = on_usr1;
+  sa.sa_flags = SA_ONSTACK;
+  sigaction(SIGUSR1, &sa, NULL);
+  memset(alt_stack, 0xa5, sizeof(alt_stack));
+  raise(SIGUSR1);
+  char* lowest = alt_stack;
+  while (*lowest == (char)0xa5) {
+    lowest++;
+  }
+  printf("stack: %d bytes\n", (int)(handler_sp - lowest));
+  fflush(stdout);
+  assert(handler_sp - lowest <= LOG_SAFE_STACK);
+  assert(logSafeFlush() == 1);
+  printf("%s\n", sent);
+
+  // latency of the longest record: a string filling the slot up to SAFE_MAX
+  char longest[SAFE_MAX - sizeof("+|\"" EMPTY_KEY "\":\"\"") + 2];
+  memset(longest, 'x', sizeof(longest) - 1);
+  longest[sizeof(longest) - 1] = '\0';
+  long latencies[1000];
+  for (int i = 0; i < 1000; i++) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int ret = log_json_safe(LEVEL_INFO, "", longest, NULL);
+    latencies[i] = elapsed_ns(&start);
+    assert(ret == 0);
+    assert(slots[(head - 1) & SAFE_MASK].len == SAFE_MAX);
+    assert(logSafeFlush() == 1);
+  }
+  qsort(latencies, 1000, sizeof(long), compare_long);
+  printf("latency: %ld ns median, %ld ns 99th percentile, %ld ns max\n", latencies[500], latencies[990], latencies[999]);
+  assert(latencies[990] < 1000);  // under 1 us, see LOG_SAFE_STACK in JsonLogger.h
+
+  // written to a file descriptor, as a crash handler would
+  int fds[2];
+  assert(pipe(fds) == 0);
+  received = 0;
+  logSafe(LEVEL_FATAL, "i|sig", 11, "crashed");
+  log_json_safe(LEVEL_INFO, "", "}|", NULL);
+  for (int i = 0; i < LOG_SAFE_SLOTS; i++) {
+    logSafe(LEVEL_INFO, "i|i", i);
+  }
+  assert(logSafeFlushFd(fds[1]) == LOG_SAFE_SLOTS);
+  assert(received == 0);
+  close(fds[1]);
+  char lines[1024];
+  ssize_t n = read(fds[0], lines, sizeof(lines) - 1);
+  close(fds[0]);
+  assert(n > 0);
+  lines[n] = '\0';
+  printf("%s", lines);
+  sprintf(buf256, "{\"l\":5,\"sig\":11,\"_\":\"crashed\"}\n\
+{\"l\":4,\"len\":-2,\"_\":\"safe_build() failed in log_json_safe()\"}\n\
+{\"l\":2,\"i\":0}\n");
+  assert(!strncmp(lines, buf256, strlen(buf256)));
+  assert(strstr(lines, "{\"l\":3,\"dropped\":2,\"_\":\"log records dropped by log_json_safe()\"}\n"));
+
+  // signal handlers interrupting logSafe()
+  signal(SIGALRM, on_alarm);
+  struct itimerval timer = {{0, 100}, {0, 100}};
+  setitimer(ITIMER_REAL, &timer, NULL);
+  received = missing = 0;
+  int calls = 0;
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (elapsed_ns(&start) < 200000000L) {
+    logSafe(LEVEL_INFO, "i|calls", calls, "from main");
+    calls++;
+    if (calls % 2 == 0) {
+      logSafeFlush();
+    }
+  }
+  timer.it_value.tv_usec = 0;
+  setitimer(ITIMER_REAL, &timer, NULL);
+  logSafeFlush();
+  int handled = received + missing - calls;
+  printf("calls=%d handled=%d received=%d missing=%d\n", calls, handled, received, missing);
+  assert(handled > 0);
+
+  return 0;
+}
+#endif
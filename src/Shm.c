@@ -0,0 +1,379 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L  // clock_gettime(), ftruncate() and nanosleep() with -std=c99
+#endif
+#include "JsonLogger.h"
+
+#ifdef LOG_SHM
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_MAGIC 0x4a534c31
+#define SHM_MAX_SLOTS (1 << 20)
+
+typedef struct {
+  uint32_t seq;  // position: free to claim, position + 1: written, position + slots: free for next round
+  uint32_t pos;  // position of the record in json, written before it
+  uint32_t sum;  // of pos, level, len and json, written after them
+  int32_t level;
+  int32_t len;
+  char json[LOG_MAX_LEN];
+} ShmSlot;
+
+typedef struct {
+  uint32_t magic;  // set last by the process creating the ring
+  uint32_t slots;
+  uint32_t slot_size;
+  uint32_t head;     // next position producers claim
+  uint32_t tail;     // next position the collector reads
+  uint32_t dropped;  // records producers couldn't put in the ring
+  uint32_t lost;     // slots the collector skipped: producer never finished, or record torn by a late producer
+  ShmSlot slot[];
+} ShmRing;
+
+static ShmRing* ring = NULL;
+static size_t ring_size = 0;
+
+// FNV-1a, catches a record torn by a producer that was descheduled past LOG_SHM_STUCK_MS
+static uint32_t record_sum(uint32_t pos, int32_t level, int32_t len, const char* json) {
+  uint32_t sum = 2166136261u ^ pos;
+  sum = (sum ^ (uint32_t)level) * 16777619u;
+  sum = (sum ^ (uint32_t)len) * 16777619u;
+  for (int32_t i = 0; i < len; i++) {
+    sum = (sum ^ (uint8_t)json[i]) * 16777619u;
+  }
+  return sum;
+}
+
+static void sleep_us(long us) {
+  struct timespec ts = {us / 1000000, us % 1000000 * 1000};
+  nanosleep(&ts, NULL);
+}
+
+static uint32_t now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int logShmOpen(const char* name, int slots) {
+  if (slots < 1 || slots > SHM_MAX_SLOTS) {
+    return JSON_ERR_SHM;
+  }
+  uint32_t n = 2;  // with 1 slot, written (position + 1) would look free for the next round
+  while (n < (uint32_t)slots) {
+    n <<= 1;
+  }
+  size_t size = sizeof(ShmRing) + n * sizeof(ShmSlot);
+
+  int8_t created = 1;
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    created = 0;
+    fd = shm_open(name, O_RDWR, 0600);
+  }
+  if (fd < 0) {
+    return JSON_ERR_SHM;
+  }
+  if (created) {
+    if (ftruncate(fd, size) < 0) {
+      close(fd);
+      shm_unlink(name);
+      return JSON_ERR_SHM;
+    }
+  } else {  // wait a bit for the creator to size it
+    struct stat st;
+    int ret;
+    for (int i = 0; (ret = fstat(fd, &st)) == 0 && st.st_size == 0 && i < 1000; i++) {
+      sleep_us(1000);
+    }
+    size = ret == 0 ? (size_t)st.st_size : 0;
+    if (size < sizeof(ShmRing)) {
+      close(fd);
+      return JSON_ERR_SHM;
+    }
+  }
+  ShmRing* r = (ShmRing*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (r == MAP_FAILED) {
+    return JSON_ERR_SHM;
+  }
+
+  if (created) {
+    r->slots = n;
+    r->slot_size = sizeof(ShmSlot);
+    for (uint32_t i = 0; i < n; i++) {
+      r->slot[i].seq = i;
+    }
+    __atomic_store_n(&r->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+  } else {
+    for (int i = 0; __atomic_load_n(&r->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC && i < 1000; i++) {
+      sleep_us(1000);
+    }
+    if (r->magic != SHM_MAGIC || r->slot_size != sizeof(ShmSlot) || r->slots < 2 || r->slots > SHM_MAX_SLOTS ||
+        (r->slots & (r->slots - 1)) ||
+        size < sizeof(ShmRing) + r->slots * sizeof(ShmSlot)) {
+      munmap(r, size);
+      return JSON_ERR_SHM;
+    }
+  }
+
+  logShmClose();
+  ring = r;
+  ring_size = size;
+  return r->slots;
+}
+
+void logShmClose() {
+  if (ring) {
+    munmap(ring, ring_size);
+    ring = NULL;
+  }
+}
+
+void logShmSend(int level, const char* json, int len) {
+  if (!ring) {
+    return;
+  }
+  if (len < 0 || len >= LOG_MAX_LEN) {
+    __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  uint32_t mask = ring->slots - 1;
+  uint32_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  ShmSlot* slot;
+  for (;;) {
+    slot = &ring->slot[pos & mask];
+    int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {  // full
+      __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+      return;
+    } else {
+      pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    }
+  }
+
+  __atomic_store_n(&slot->pos, pos, __ATOMIC_RELAXED);
+  slot->level = level;
+  slot->len = len;
+  memcpy(slot->json, json, len + 1);
+  __atomic_store_n(&slot->sum, record_sum(pos, level, len, json), __ATOMIC_RELAXED);
+  uint32_t claimed = pos;
+  // fails if we were too slow and the collector skipped the slot: already counted as lost there
+  __atomic_compare_exchange_n(&slot->seq, &claimed, pos + 1, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+}
+
+int logShmDrain(int max_records) {
+  static int8_t stuck = 0;
+  static uint32_t stuck_pos, stuck_since;
+  static uint32_t reported_dropped = 0, reported_lost = 0;
+  if (!ring) {
+    return JSON_ERR_SHM;
+  }
+
+  char json[LOG_MAX_LEN];
+  uint32_t mask = ring->slots - 1;
+  int count = 0;
+  while (count < max_records) {
+    uint32_t pos = ring->tail;
+    ShmSlot* slot = &ring->slot[pos & mask];
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq == pos + 1) {
+      // copy it out and check it wasn't written over by a late producer (seqlock-style), before and after copying
+      uint32_t tagged = __atomic_load_n(&slot->pos, __ATOMIC_ACQUIRE);
+      int32_t level = slot->level;
+      int32_t len = slot->len;
+      int8_t intact = tagged == pos && len >= 0 && len < LOG_MAX_LEN;
+      if (intact) {
+        memcpy(json, slot->json, len);
+        json[len] = '\0';
+        uint32_t sum = __atomic_load_n(&slot->sum, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        intact = __atomic_load_n(&slot->pos, __ATOMIC_RELAXED) == pos && sum == record_sum(pos, level, len, json);
+      }
+      __atomic_store_n(&slot->seq, pos + ring->slots, __ATOMIC_RELEASE);
+      ring->tail = pos + 1;
+      stuck = 0;
+      if (intact) {
+        log_send(level, json, len);
+        count++;
+      } else {
+        __atomic_fetch_add(&ring->lost, 1, __ATOMIC_RELAXED);
+      }
+    } else if (seq == pos && (int32_t)(__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - pos) > 0) {
+      // claimed but not written yet: skip it if its producer takes too long (crashed)
+      uint32_t now = now_ms();
+      if (!stuck || stuck_pos != pos) {
+        stuck = 1;
+        stuck_pos = pos;
+        stuck_since = now;
+        break;
+      }
+      if (now - stuck_since < LOG_SHM_STUCK_MS) {
+        break;
+      }
+      if (__atomic_compare_exchange_n(&slot->seq, &seq, pos + ring->slots, 0, __ATOMIC_ACQ_REL,
+                                      __ATOMIC_ACQUIRE)) {
+        ring->tail = pos + 1;
+        __atomic_fetch_add(&ring->lost, 1, __ATOMIC_RELAXED);
+      }
+      stuck = 0;
+    } else {
+      break;
+    }
+  }
+
+  uint32_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+  uint32_t lost = __atomic_load_n(&ring->lost, __ATOMIC_RELAXED);
+  if (dropped != reported_dropped || lost != reported_lost) {
+    log_json(LEVEL_WARN, "", "i|dropped", (int32_t)(dropped - reported_dropped), "i|lost",
+             (int32_t)(lost - reported_lost), "log records missing from shared memory", NULL);
+    reported_dropped = dropped;
+    reported_lost = lost;
+  }
+  return count;
+}
+
+#ifdef SHM_COLLECTOR
+// gcc -O2 -DLOG_SHM -DSHM_COLLECTOR src/*.c -o json-collector -lrt; ./json-collector /jsonlogger 64 >> log.json
+
+void send_stdout(int level, const char* json, int len) {
+  fwrite(json, 1, len, stdout);
+  fputc('\n', stdout);
+}
+
+int main(int argc, char** argv) {
+  const char* name = argc > 1 ? argv[1] : "/jsonlogger";
+  int slots = argc > 2 ? atoi(argv[2]) : 64;
+  if (logShmOpen(name, slots) < 0) {
+    fprintf(stderr, "can't open shared memory %s\n", name);
+    return 1;
+  }
+  logAddSender(send_stdout);
+  for (;;) {
+    if (logShmDrain(slots) == 0) {
+      fflush(stdout);
+      sleep_us(10000);
+    }
+  }
+}
+#endif
+
+#ifdef SHM_TEST
+// gcc -Os -DLOG_SHM -DSHM_TEST -DLOG_SHM_STUCK_MS=10 src/*.c -lrt; ./a.out; rm ./a.out
+
+#include <assert.h>
+#include <sys/wait.h>
+
+#define SHM_TEST_NAME "/jsonlogger_test"
+
+static int received = 0, dropped = 0, lost = 0;
+
+void send_collect(int level, const char* json, int len) {
+  const char* missing = strstr(json, "\"dropped\":");
+  if (missing) {
+    int d, l;
+    assert(sscanf(missing, "\"dropped\":%d,\"lost\":%d", &d, &l) == 2);
+    dropped += d;
+    lost += l;
+  } else {
+    assert(len == strlen(json));
+    assert(!strncmp(json, "{\"l\":2,\"pid\":", 13));
+    received++;
+  }
+}
+
+// each producer opens the ring on its own
+static void produce(int records, int pause_us, int8_t crash) {
+  if (fork() == 0) {
+    int slots = logShmOpen(SHM_TEST_NAME, 1);  // the ring exists: keeps its size
+    assert(slots == 8);
+    if (crash) {  // claims a slot and dies before writing it
+      __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+      _exit(0);
+    }
+    logAddSender(logShmSend);
+    for (int i = 0; i < records; i++) {
+      logInfo("i|pid", getpid(), "i|i", i);
+      if (pause_us) {
+        sleep_us(pause_us);
+      }
+    }
+    _exit(0);
+  }
+}
+
+static void drain_all() {
+  while (logShmDrain(8) > 0) {
+  }
+}
+
+int main() {
+  shm_unlink(SHM_TEST_NAME);
+  assert(logShmOpen(SHM_TEST_NAME, 0) == JSON_ERR_SHM);
+  assert(logShmOpen(SHM_TEST_NAME, -1) == JSON_ERR_SHM);
+  assert(logShmOpen(SHM_TEST_NAME, SHM_MAX_SLOTS + 1) == JSON_ERR_SHM);
+  int slots = logShmOpen(SHM_TEST_NAME, 6);
+  assert(slots == 8);
+  logAddSender(send_collect);
+
+  // producers and collector running at the same time
+  for (int i = 0; i < 4; i++) {
+    produce(500, 100, 0);
+  }
+  for (int running = 4; running > 0;) {
+    logShmDrain(8);
+    if (waitpid(-1, NULL, WNOHANG) > 0) {
+      running--;
+    }
+  }
+  drain_all();
+  printf("received=%d dropped=%d lost=%d\n", received, dropped, lost);
+  assert(received + dropped == 2000);
+  assert(lost == 0);
+
+  // full ring
+  received = dropped = 0;
+  produce(10, 0, 0);
+  wait(NULL);
+  drain_all();
+  printf("received=%d dropped=%d lost=%d\n", received, dropped, lost);
+  assert(received == 8 && dropped == 2 && lost == 0);
+
+  // crashed producer
+  received = dropped = 0;
+  produce(0, 0, 1);
+  wait(NULL);
+  produce(1, 0, 0);
+  wait(NULL);
+  assert(logShmDrain(8) == 0);
+  assert(received == 0);
+  sleep_us(20000);
+  assert(logShmDrain(8) == 1);
+  printf("received=%d dropped=%d lost=%d\n", received, dropped, lost);
+  assert(received == 1 && dropped == 0 && lost == 1);
+
+  // record torn by a producer that was only descheduled and wrote into the slot after it was skipped
+  received = lost = 0;
+  produce(2, 0, 0);
+  wait(NULL);
+  ring->slot[ring->tail & (ring->slots - 1)].json[2] ^= 1;
+  drain_all();
+  printf("received=%d dropped=%d lost=%d\n", received, dropped, lost);
+  assert(received == 1 && dropped == 0 && lost == 1);
+
+  logShmClose();
+  shm_unlink(SHM_TEST_NAME);
+  return 0;
+}
+#endif
+
+#endif
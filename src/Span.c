@@ -0,0 +1,164 @@
+#include "JsonLogger.h"
+
+#ifdef LOG_SPAN
+
+typedef struct {
+  const char* name;
+  uint32_t ts, dur;
+} SpanEvent;
+
+typedef struct {
+  SpanEvent done[LOG_SPAN_SLOTS];  // finished, not sent yet
+  int count;
+  const char* open_name[LOG_SPAN_DEPTH];
+  uint32_t open_ts[LOG_SPAN_DEPTH];
+  int depth;  // can be more than LOG_SPAN_DEPTH, the deeper spans are not kept
+  int32_t tid;
+} SpanBuffer;
+
+static LOG_THREAD_LOCAL SpanBuffer spans;
+static int32_t last_tid = 0;
+
+void logSpanBegin(const char* name) {
+  if (spans.depth < LOG_SPAN_DEPTH) {
+    spans.open_name[spans.depth] = name;
+    spans.open_ts[spans.depth] = getLogMicros();
+  }
+  spans.depth++;
+}
+
+void logSpanEnd() {
+  uint32_t now = getLogMicros();
+  if (spans.depth == 0) {
+    return;
+  }
+  spans.depth--;
+  if (spans.depth >= LOG_SPAN_DEPTH) {
+    return;
+  }
+  if (spans.count >= LOG_SPAN_SLOTS) {
+    logSpanFlush();
+  }
+  SpanEvent* span = &spans.done[spans.count++];
+  span->name = spans.open_name[spans.depth];
+  span->ts = spans.open_ts[spans.depth];
+  span->dur = now - span->ts;
+}
+
+static int write_span(void* ctx, char* json, int room, int8_t first) {
+  int* i = (int*)ctx;
+  if (*i >= spans.count) {
+    return 0;
+  }
+  SpanEvent* span = &spans.done[*i];
+  int n = build_json(json, room, "name", span->name, "ph", "X", "fa|ts", (double)span->ts, "fa|dur", (double)span->dur,
+                     "i|pid", LOG_SPAN_PID, "i|tid", spans.tid, NULL);
+  if (n >= 0 || first) {  // too long even on its own: skipped
+    (*i)++;
+  }
+  return n;
+}
+
+int logSpanFlush() {
+  if (!spans.tid) {
+    spans.tid = __atomic_add_fetch(&last_tid, 1, __ATOMIC_RELAXED);
+  }
+  int i = 0;
+  log_json_items(LOG_SPAN_LEVEL, "\"traceEvents\":[", "]", write_span, &i);
+  spans.count = 0;
+  return i;
+}
+
+#ifdef SPAN_TEST
+// gcc -Os -DLOG_SPAN -DSPAN_TEST src/*.c -lpthread; ./a.out; rm ./a.out
+
+#include <assert.h>
+#include <pthread.h>
+
+static char sent[LOG_MAX_LEN];
+static int sent_count = 0;
+static uint32_t micros = 0;
+
+uint32_t getLogMicros() {
+  return __atomic_add_fetch(&micros, 10, __ATOMIC_RELAXED);  // 10 us between readings
+}
+
+void send_capture(int level, const char* json, int len) {
+  printf("%s\n", json);
+  assert(len == strlen(json));
+  memcpy(sent, json, len + 1);
+  sent_count++;
+}
+
+static void* other_thread(void* arg) {
+  logSpanBegin("other");
+  logSpanEnd();
+  *(int*)arg = logSpanFlush();
+  return NULL;
+}
+
+int main() {
+  logAddSender(send_capture);
+
+  // nested
+  logSpanBegin("outer");
+  logSpanBegin("inner \"1\"");
+  logSpanEnd();
+  logSpanEnd();
+  assert(sent_count == 0);
+  assert(logSpanFlush() == 2);
+  assert(sent_count == 1);
+  assert(!strcmp(sent, "{\"l\":2,\"traceEvents\":[\
+{\"name\":\"inner \\\"1\\\"\",\"ph\":\"X\",\"ts\":20,\"dur\":10,\"pid\":1,\"tid\":1},\
+{\"name\":\"outer\",\"ph\":\"X\",\"ts\":10,\"dur\":30,\"pid\":1,\"tid\":1}]}"));
+  assert(logSpanFlush() == 0);
+  assert(sent_count == 1);
+
+  // each thread has its own spans and tid
+  int flushed;
+  pthread_t thread;
+  logSpanBegin("main");
+  pthread_create(&thread, NULL, other_thread, &flushed);
+  pthread_join(thread, NULL);
+  assert(flushed == 1);
+  assert(strstr(sent, "\"name\":\"other\"") && strstr(sent, "\"tid\":2"));
+  logSpanEnd();
+  assert(logSpanFlush() == 1);
+  assert(strstr(sent, "\"name\":\"main\"") && strstr(sent, "\"tid\":1"));
+
+  // full buffer sends by itself, in as many records as it takes
+  sent_count = 0;
+  for (int i = 0; i < LOG_SPAN_SLOTS + 1; i++) {
+    logSpanBegin("loop");
+    logSpanEnd();
+  }
+  assert(sent_count > 1);
+  assert(logSpanFlush() == 1);
+
+  // too deep, and too many ends
+  sent_count = 0;
+  for (int i = 0; i < LOG_SPAN_DEPTH + 2; i++) {
+    logSpanBegin("deep");
+  }
+  for (int i = 0; i < LOG_SPAN_DEPTH + 4; i++) {
+    logSpanEnd();
+  }
+  assert(logSpanFlush() == LOG_SPAN_DEPTH);
+
+  // a span too long for a record is skipped
+  static char long_name[LOG_MAX_LEN];
+  memset(long_name, 'x', sizeof(long_name) - 1);
+  sent_count = 0;
+  logSpanBegin(long_name);
+  logSpanEnd();
+  logSpanBegin("short");
+  logSpanEnd();
+  assert(logSpanFlush() == 2);
+  assert(sent_count == 1);
+  assert(strstr(sent, "\"name\":\"short\"") && !strstr(sent, "xxx"));
+
+  return 0;
+}
+#endif
+
+#endif